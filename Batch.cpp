@@ -0,0 +1,522 @@
+/*
+ * Batch.cpp
+ *
+ * Author: Michael Denny
+ *
+ * Headless batch play, split across worker processes.
+ *
+ * A coordinator forks a number of workers and talks to each of them
+ * over a pair of pipes using a line based text protocol:
+ *
+ *   coordinator -> worker:
+ *     JOB <seed_start> <seed_count> <rows> <columns>
+ *     QUIT
+ *
+ *   worker -> coordinator:
+ *     GAME <seed> <moves> <max_tile> <won> <end_board>   (one per game)
+ *     DONE <seed_start>                        (job finished)
+ *
+ * Every game is played right after srand(seed), so the results of a
+ * batch only depend on the seed range, not on how many workers ran it
+ * or which worker got which job. Seeds run from 0 to UINT_MAX, the
+ * range of srand(), so a seed never wraps around onto a smaller one.
+ * The GAME lines of a job are only merged into the totals once its
+ * DONE line arrives. If a worker dies
+ * part way through a job, or sends nothing for stall_timeout seconds
+ * while it has a job, its partial results are thrown away, it is
+ * killed, a new worker is started and the whole job is handed out again.
+ *
+ * end_board is the final board, packed as in Symmetry.h and written in
+ * hex, or 0 if the board is too big to pack. With end_states set, the
+ * coordinator counts final boards in a Canonical_cache, so mirror
+ * images of the same final board are counted as one.
+ *
+ * "2048 --worker" speaks the same protocol on stdin/stdout, so a worker
+ * can also be run on another machine behind ssh, socat, etc.
+ *
+ */
+
+#include "Batch.h"
+#include "Profile.h"
+#include "Symmetry.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <deque>
+#include <memory>
+
+
+//Result of a single game, as reported by a worker
+struct Game_result {
+    long seed;
+    int moves;
+    int max_tile;
+    int won;
+    uint64_t end_board;
+};
+
+//Coordinator side bookkeeping for one worker process
+struct Worker_slot {
+    pid_t pid;
+    int to_worker;		//write end of the request pipe
+    int from_worker;		//read end of the reply pipe
+    bool busy;			//true while a job is handed out
+    long deadline_ms;		//busy worker counts as hung after this time
+    Batch_job job;		//the job currently handed out
+    std::string buffer;		//partial reply line(s) read so far
+    std::vector<Game_result> pending;  //results of the current job
+};
+
+
+//Zero out a summary
+void init_batch_summary(Batch_summary &summary)
+{
+    summary.games = 0;
+    summary.wins = 0;
+    summary.total_moves = 0;
+    summary.max_tile = 0;
+    summary.failed_jobs = 0;
+    summary.workers = 0;
+    summary.worker_restarts = 0;
+    summary.end_states = 0;
+    summary.common_end_state = 0;
+    summary.common_end_state_count = 0;
+}
+
+
+//Play a single game with random moves, starting from the given seed.
+//  The game object is reused between games, so its rows and columns
+//  decide the size of the board. Returns the number of moves made.
+int play_batch_game(long seed, Game &game)
+{
+    PROFILE_SCOPE("play_batch_game");
+    srand((unsigned int)seed);
+    game.reset_game();
+    while (!game.is_game_over())
+	game.execute_random_move();
+    return game.get_move_count();
+}
+
+
+//Current CLOCK_MONOTONIC time in milliseconds
+static long now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+
+//Write a whole buffer to a file descriptor, retrying on short writes.
+//  Returns false if the other end has gone away.
+static bool write_all(int fd, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+	ssize_t written = write(fd, data, length);
+	if (written < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    return false;
+	}
+	data += written;
+	length -= written;
+    }
+    return true;
+}
+
+
+//Worker main loop
+//  Reads JOB requests from in_fd until QUIT or end of file, plays the
+//  requested games and writes the results to out_fd.
+//  For testing the retry logic, setting BATCH_WORKER_CRASH_AFTER=N in
+//  the environment makes the worker die in the middle of its (N+1)th job,
+//  and BATCH_WORKER_HANG_AFTER=N makes it stop responding there instead.
+int run_worker(int in_fd, int out_fd)
+{
+    FILE* in = fdopen(in_fd, "r");
+    FILE* out = fdopen(out_fd, "w");
+    if (in == NULL || out == NULL)
+	return 1;
+
+    int crash_after = -1;
+    const char* crash_setting = getenv("BATCH_WORKER_CRASH_AFTER");
+    if (crash_setting != NULL)
+	crash_after = atoi(crash_setting);
+
+    int hang_after = -1;
+    const char* hang_setting = getenv("BATCH_WORKER_HANG_AFTER");
+    if (hang_setting != NULL)
+	hang_after = atoi(hang_setting);
+
+    int jobs_done = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+	if (strncmp(line, "QUIT", 4) == 0)
+	    break;
+
+	//Reject requests we can not play as asked, rather than playing
+	//  some other board or seed count under the requested label
+	Batch_job job;
+	if (sscanf(line, "JOB %ld %d %d %d", &job.seed_start, &job.seed_count, &job.rows, &job.columns) != 4
+	    || job.seed_count < 0 || job.seed_start < 0 || job.seed_start > (long)UINT_MAX - job.seed_count + 1
+	    || !Game::is_valid_size(job.rows, job.columns))
+	{
+	    fprintf(out, "ERROR bad request\n");
+	    fflush(out);
+	    continue;
+	}
+
+	Game game(job.rows, job.columns);
+	for (int i = 0; i < job.seed_count; i++)
+	{
+	    long seed = job.seed_start + i;
+	    int moves = play_batch_game(seed, game);
+	    uint64_t end_board;
+	    if (!game.get_packed_board(end_board))
+		end_board = 0;
+	    fprintf(out, "GAME %ld %d %d %d %llx\n", seed, moves, game.get_max_tile(),
+		    game.is_game_won() ? 1 : 0, (unsigned long long)end_board);
+
+	    //Simulated crash, half way through a job
+	    if (jobs_done == crash_after && i == job.seed_count / 2)
+	    {
+		fflush(out);
+		_exit(2);
+	    }
+
+	    //Simulated hang, half way through a job
+	    if (jobs_done == hang_after && i == job.seed_count / 2)
+	    {
+		fflush(out);
+		while (true)
+		    pause();
+	    }
+	}
+	fprintf(out, "DONE %ld\n", job.seed_start);
+	fflush(out);
+	jobs_done++;
+    }
+
+    fclose(in);
+    fclose(out);
+    profile_export();
+    return 0;
+}
+
+
+//Fork a new worker process into the given slot.
+//  The child closes every pipe belonging to the other workers, so that
+//  a dead worker is always seen as end of file by the coordinator.
+static bool spawn_worker(Worker_slot &slot, std::vector<Worker_slot> &slots)
+{
+    int request_pipe[2], reply_pipe[2];
+    if (pipe(request_pipe) < 0)
+	return false;
+    if (pipe(reply_pipe) < 0)
+    {
+	close(request_pipe[0]);
+	close(request_pipe[1]);
+	return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+	close(request_pipe[0]);
+	close(request_pipe[1]);
+	close(reply_pipe[0]);
+	close(reply_pipe[1]);
+	return false;
+    }
+
+    if (pid == 0)  //child
+    {
+	for (int i = 0; i < slots.size(); i++)
+	    if (&slots[i] != &slot && slots[i].pid > 0)
+	    {
+		close(slots[i].to_worker);
+		close(slots[i].from_worker);
+	    }
+	close(request_pipe[1]);
+	close(reply_pipe[0]);
+	_exit(run_worker(request_pipe[0], reply_pipe[1]));
+    }
+
+    //parent
+    close(request_pipe[0]);
+    close(reply_pipe[1]);
+    slot.pid = pid;
+    slot.to_worker = request_pipe[1];
+    slot.from_worker = reply_pipe[0];
+    slot.busy = false;
+    slot.buffer.clear();
+    slot.pending.clear();
+    return true;
+}
+
+
+//Tear down a worker process and its pipes
+static void reap_worker(Worker_slot &slot, bool force)
+{
+    close(slot.to_worker);
+    close(slot.from_worker);
+    if (force)
+	kill(slot.pid, SIGKILL);
+    waitpid(slot.pid, NULL, 0);
+    slot.pid = -1;
+}
+
+
+//Hand a job to an idle worker. Returns false if the worker is gone.
+//  The worker has stall_timeout seconds to send its first reply.
+static bool assign_job(Worker_slot &slot, Batch_job job, int stall_timeout)
+{
+    char line[128];
+    job.attempts++;
+    slot.job = job;
+    slot.busy = true;
+    slot.deadline_ms = now_ms() + stall_timeout * 1000L;
+    slot.pending.clear();
+    int length = snprintf(line, sizeof(line), "JOB %ld %d %d %d\n",
+			  job.seed_start, job.seed_count, job.rows, job.columns);
+    return write_all(slot.to_worker, line, length);
+}
+
+
+//Handle a worker that died or misbehaved: put its job back on the queue
+//  (or give up on it after too many attempts) and start a replacement.
+static bool handle_failed_worker(Worker_slot &slot, std::vector<Worker_slot> &slots,
+				 std::deque<Batch_job> &queue, long &jobs_left,
+				 const Batch_options &options, Batch_summary &summary)
+{
+    if (slot.busy)
+    {
+	if (slot.job.attempts <= options.max_retries)
+	    queue.push_front(slot.job);
+	else
+	{
+	    summary.failed_jobs++;
+	    jobs_left--;
+	}
+    }
+    reap_worker(slot, true);
+    summary.worker_restarts++;
+    return spawn_worker(slot, slots);
+}
+
+
+//Parse every complete line in a worker's buffer.
+//  Returns false if the worker sent something we do not understand.
+//  end_states is NULL unless final boards are being counted.
+static bool process_replies(Worker_slot &slot, long &jobs_left, Batch_summary &summary,
+			    Canonical_cache<long>* end_states)
+{
+    size_t newline;
+    while ((newline = slot.buffer.find('\n')) != std::string::npos)
+    {
+	std::string line = slot.buffer.substr(0, newline);
+	slot.buffer.erase(0, newline + 1);
+
+	Game_result result;
+	long seed_start;
+	unsigned long long end_board;
+	if (sscanf(line.c_str(), "GAME %ld %d %d %d %llx", &result.seed, &result.moves,
+		   &result.max_tile, &result.won, &end_board) == 5)
+	{
+	    result.end_board = end_board;
+	    slot.pending.push_back(result);
+	}
+	else if (sscanf(line.c_str(), "DONE %ld", &seed_start) == 1 && slot.busy
+		 && seed_start == slot.job.seed_start && slot.pending.size() == slot.job.seed_count)
+	{
+	    //Job finished, merge its games into the totals
+	    for (int i = 0; i < slot.pending.size(); i++)
+	    {
+		summary.games++;
+		summary.wins += slot.pending[i].won;
+		summary.total_moves += slot.pending[i].moves;
+		if (slot.pending[i].max_tile > summary.max_tile)
+		    summary.max_tile = slot.pending[i].max_tile;
+
+		if (end_states != NULL && slot.pending[i].end_board != 0)
+		{
+		    long &count = (*end_states)[slot.pending[i].end_board];
+		    count++;
+		    if (count > summary.common_end_state_count)
+		    {
+			summary.common_end_state_count = count;
+			summary.common_end_state = canonical_board(slot.pending[i].end_board,
+								   slot.job.rows, slot.job.columns);
+		    }
+		}
+	    }
+	    if (end_states != NULL)
+		summary.end_states = end_states->size();
+	    slot.pending.clear();
+	    slot.busy = false;
+	    jobs_left--;
+	}
+	else
+	    return false;
+    }
+    return true;
+}
+
+
+//Coordinator main loop
+//  Splits the seed range into jobs, hands them out to the workers as
+//  they become idle and merges the results into summary.
+//  Returns 0 on success, 1 if workers could not be started.
+int run_coordinator(const Batch_options &options, Batch_summary &summary)
+{
+    init_batch_summary(summary);
+
+    //Writing to a dead worker should fail with EPIPE, not kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    //Split the seed range up into jobs
+    std::deque<Batch_job> queue;
+    int job_size = options.job_size > 0 ? options.job_size : 1;
+    for (long first = 0; first < options.total_games; first += job_size)
+    {
+	Batch_job job;
+	job.seed_start = options.seed_start + first;
+	job.seed_count = std::min((long)job_size, options.total_games - first);
+	job.rows = options.rows;
+	job.columns = options.columns;
+	job.attempts = 0;
+	queue.push_back(job);
+    }
+    long jobs_left = queue.size();
+
+    //Database of final boards, keyed up to symmetry
+    std::unique_ptr<Canonical_cache<long> > end_state_table;
+    if (options.end_states && packed_board_fits(options.rows, options.columns))
+	end_state_table.reset(new Canonical_cache<long>(options.rows, options.columns));
+    Canonical_cache<long>* end_states = end_state_table.get();
+
+    //No point starting more workers than there are jobs
+    int worker_count = options.worker_count > 0 ? options.worker_count : 1;
+    if (worker_count > jobs_left)
+    {
+	fprintf(stderr, "Only %ld job(s) with --job-size %d: starting %ld worker(s) instead of %d\n",
+		jobs_left, job_size, jobs_left, worker_count);
+	worker_count = jobs_left;
+    }
+    summary.workers = worker_count;
+
+    //Reserve up front: spawn_worker() relies on slot addresses staying put
+    std::vector<Worker_slot> slots(worker_count);
+    for (int i = 0; i < worker_count; i++)
+	slots[i].pid = -1;
+    for (int i = 0; i < worker_count; i++)
+	if (!spawn_worker(slots[i], slots))
+	{
+	    perror("fork");
+	    for (int j = 0; j < i; j++)
+		reap_worker(slots[j], true);
+	    return 1;
+	}
+
+    std::vector<struct pollfd> poll_fds;
+    std::vector<int> poll_slots;
+    char read_buffer[4096];
+
+    while (jobs_left > 0)
+    {
+	//Hand out work to every idle worker
+	for (int i = 0; i < worker_count; i++)
+	    while (!slots[i].busy && !queue.empty())
+	    {
+		Batch_job job = queue.front();
+		queue.pop_front();
+		if (!assign_job(slots[i], job, options.stall_timeout)
+		    && !handle_failed_worker(slots[i], slots, queue, jobs_left, options, summary))
+		{
+		    perror("fork");
+		    return 1;
+		}
+	    }
+
+	//Wait for replies from the busy workers, but no longer than
+	//  the earliest stall deadline
+	poll_fds.clear();
+	poll_slots.clear();
+	long next_deadline = 0;
+	for (int i = 0; i < worker_count; i++)
+	    if (slots[i].busy)
+	    {
+		if (poll_fds.empty() || slots[i].deadline_ms < next_deadline)
+		    next_deadline = slots[i].deadline_ms;
+		struct pollfd entry;
+		entry.fd = slots[i].from_worker;
+		entry.events = POLLIN;
+		entry.revents = 0;
+		poll_fds.push_back(entry);
+		poll_slots.push_back(i);
+	    }
+	if (poll_fds.empty())
+	    continue;
+	long wait_ms = std::max(0L, next_deadline - now_ms());
+	if (poll(&poll_fds[0], poll_fds.size(), (int)std::min(wait_ms, 1000000L)) < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    perror("poll");
+	    return 1;
+	}
+
+	long now = now_ms();
+	for (int p = 0; p < poll_fds.size(); p++)
+	{
+	    Worker_slot &slot = slots[poll_slots[p]];
+
+	    //Hung worker: nothing to read and past its deadline
+	    if (poll_fds[p].revents == 0)
+	    {
+		if (now >= slot.deadline_ms
+		    && !handle_failed_worker(slot, slots, queue, jobs_left, options, summary))
+		{
+		    perror("fork");
+		    return 1;
+		}
+		continue;
+	    }
+
+	    ssize_t count = read(slot.from_worker, read_buffer, sizeof(read_buffer));
+	    if (count < 0 && errno == EINTR)
+		continue;
+
+	    bool healthy = count > 0;
+	    if (healthy)
+	    {
+		slot.buffer.append(read_buffer, count);
+		slot.deadline_ms = now + options.stall_timeout * 1000L;
+		healthy = process_replies(slot, jobs_left, summary, end_states);
+	    }
+	    if (!healthy && !handle_failed_worker(slot, slots, queue, jobs_left, options, summary))
+	    {
+		perror("fork");
+		return 1;
+	    }
+	}
+    }
+
+    //All done, let the workers go
+    for (int i = 0; i < worker_count; i++)
+    {
+	write_all(slots[i].to_worker, "QUIT\n", 5);
+	reap_worker(slots[i], false);
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef __Batch_h__
+#define __Batch_h__
+
+#include <string>
+#include "Game.h"
+
+//A range of seeds to play, handed from the coordinator to a worker.
+//  Game number i of the job is played after srand(seed_start + i).
+struct Batch_job {
+    long seed_start;
+    int seed_count;
+    int rows;
+    int columns;
+    int attempts;	//how many times this job has been handed out
+};
+
+//Running totals for a batch of games (merged from per-game results)
+struct Batch_summary {
+    long games;
+    long wins;
+    long total_moves;
+    int max_tile;
+    long failed_jobs;	//jobs that ran out of retries
+    int workers;		//worker processes actually run (at most one per job)
+    long worker_restarts;
+    long end_states;		//distinct final boards, up to symmetry (with Batch_options.end_states)
+    uint64_t common_end_state;	//most frequent final board (canonical, packed)
+    long common_end_state_count;
+};
+
+//Settings for a coordinator run
+struct Batch_options {
+    long total_games;
+    int worker_count;
+    int rows;
+    int columns;
+    long seed_start;
+    int job_size;	//games per job
+    int max_retries;	//per job, before it is given up on
+    int stall_timeout;	//seconds without output before a busy worker counts as hung
+    bool end_states;	//count distinct final boards (boards of up to 16 tiles only)
+};
+
+void init_batch_summary(Batch_summary &summary);
+int play_batch_game(long seed, Game &game);
+int run_worker(int in_fd, int out_fd);
+int run_coordinator(const Batch_options &options, Batch_summary &summary);
+
+
+#endif
@@ -5,65 +5,86 @@
  *
  * This class implements a slightly customizable "2048" clone.
  * 2048 is a popular game, you can google it for more information.
- * This version allows for a varying size of square playing grid.
- * The standard size is 4x4.
+ * This version allows for a varying size of rectangular playing grid
+ * (rows x columns). The standard size is 4x4.
  *
  */
 
 
 #include "Game.h"
+#include "Profile.h"
+
+//Block size used when copying the board into its transposed copy.
+//  8x8 Tiles (512 bytes) of source and destination fit easily in L1.
+static const int TRANSPOSE_BLOCK = 8;
 
 //Default constructor. Creates game with 4x4 grid playing area.
 Game::Game() {
-    this->grid_size = 4;
+    this->rows = 4;
+    this->columns = 4;
     this->initialize();
     move_counter = 0;
 }
 
 //Constructor which lets you set the grid size to an arbitrary int.
+//  The grid is square: grid_size x grid_size.
 Game::Game(int input_grid_size) {
 
     //ensure we get a sensible grid_size as input
     if (input_grid_size <= 1)
 	input_grid_size = 4;  //fallback to default if needed
 
-    this->grid_size = input_grid_size;
+    this->rows = input_grid_size;
+    this->columns = input_grid_size;
     this->initialize();
     move_counter = 0;
 }
 
-//Destructor
-//  The game board is of type Tile**, a 2D array of pointers to Tile objects.
-//  We need to iterate through the Tile** and free all the Tile*'s.
-//  Finally, we free the Tile**.
-Game::~Game() {
-    for (int row = 0; row < grid_size; row++)
-	free(game_board[row]);
-    free(game_board);
+//Constructor for a rectangular grid, rows x columns.
+//  Unlike the square constructor there is no fallback: a caller asking
+//  for a particular board would otherwise report results for a board
+//  it never got. Check the size with is_valid_size() first.
+Game::Game(int input_rows, int input_columns) {
+
+    assert(is_valid_size(input_rows, input_columns));
+
+    this->rows = input_rows;
+    this->columns = input_columns;
+    this->initialize();
+    move_counter = 0;
+}
+
+
+//Check if a board of rows x columns can be played: at least two
+//  tiles, and no more than MAX_TILES (so that the board can be
+//  allocated and every tile index fits in an int).
+bool Game::is_valid_size(long rows, long columns)
+{
+    if (rows < 1 || columns < 1 || rows > MAX_TILES || columns > MAX_TILES)
+	return false;
+    long tiles = rows * columns;  //both at most MAX_TILES, so no overflow
+    return tiles >= 2 && tiles <= MAX_TILES;
 }
 
 
 //Initialize the game
-//  The game board a 2D array of pinters to Tile objects. A Tile is a
-//    struct which is defined in Game.h. We need to malloc space for
-//    our Tile** gameboard. While we are at it, we need to initialize
-//    the data members for all the Tile objects.
+//  The game board is a flat, row-major array of Tile objects. A Tile
+//    is a struct which is defined in Game.h. A second, column-major
+//    copy of the board is kept for up/down moves. We need to size both
+//    of them and initialize the data members of all the Tile objects.
 void Game::initialize() {
-    game_board = (Tile**)malloc(sizeof(Tile*) * grid_size);
-    for (int row = 0; row < grid_size; row++)
-	game_board[row] = (Tile*)malloc(sizeof(Tile) * grid_size);
-    for (int row = 0; row < grid_size; row++)
-	for (int column = 0; column < grid_size; column++)
-	{
-	    game_board[row][column].value = 0;
-	    game_board[row][column].color = 0;
-	}
+    Tile empty;
+    empty.value = 0;
+    empty.color = 0;
+    game_board.assign(rows * columns, empty);
+    transposed_board.assign(rows * columns, empty);
+
     //The game board has been created and is empty. We need to
     //  populate the first non-empty Tile with '2'. We choose
     //  a random Tile to start off the game.
-    int random1 = rand() % grid_size;
-    int random2 = rand() % grid_size;
-    game_board[random1][random2].value = 2;
+    int random1 = rand() % rows;
+    int random2 = rand() % columns;
+    set_tile_value(random1, random2, 2);
 }
 
 
@@ -79,34 +100,80 @@ void Game::reset_game()
     move_counter = 0;
 
     //Zero out all the Tiles
-    for (int row = 0; row < grid_size; row++)
-	for (int column = 0; column < grid_size; column++)
-	    game_board[row][column].value = 0;
+    for (int index = 0; index < game_board.size(); index++)
+    {
+	game_board[index].value = 0;
+	transposed_board[index].value = 0;
+    }
 
     //Select random tile to start the next game with
-    int random1 = rand()%grid_size;
-    int random2 = rand()%grid_size;
-    game_board[random1][random2].value = 2;
+    int random1 = rand()%rows;
+    int random2 = rand()%columns;
+    set_tile_value(random1, random2, 2);
+}
+
+
+//Set the value of a single tile, in both copies of the board
+void Game::set_tile_value(int row, int column, int value)
+{
+    game_board[row * columns + column].value = value;
+    transposed_board[column * rows + row].value = value;
 }
 
 
 //Check if the game is won.
 //  This is typically called after is_game_over() returns true.
-//  We iterate through each Tile, checking their values. 
+//  We iterate through each Tile, checking their values.
 //  If anyone of them is 2048 or larger (should be impossible to
-//    be larger), then the game is won and we return true. 
+//    be larger), then the game is won and we return true.
 //  If we get through all the Tiles without seeing 2048, then the
 //    game was lost and we return false.
 bool Game::is_game_won()
 {
-    for (int row = 0; row < grid_size; row++)
-	for (int column = 0; column < grid_size; column++)
-	    if (game_board[row][column].value >= 2048)
-		return true;
+    PROFILE_SCOPE("is_game_won");
+    for (int index = 0; index < game_board.size(); index++)
+	if (game_board[index].value >= 2048)
+	    return true;
     return false;
 }
 
 
+//Get max tile
+//  Returns the largest tile value currently on the board.
+int Game::get_max_tile()
+{
+    int max_tile = 0;
+    for (int index = 0; index < game_board.size(); index++)
+	if (game_board[index].value > max_tile)
+	    max_tile = game_board[index].value;
+    return max_tile;
+}
+
+
+//Get packed board
+//  Packs the board into a uint64_t, 4 bits per tile holding log2 of
+//    the tile value (0 for empty), row-major. See Symmetry.h.
+//  Returns false if the board does not fit: more than 16 tiles, or a
+//    tile of 2^16 or larger.
+bool Game::get_packed_board(uint64_t &packed)
+{
+    if (game_board.size() > 16)
+	return false;
+
+    packed = 0;
+    for (int index = 0; index < game_board.size(); index++)
+    {
+	int exponent = 0;
+	while ((1 << exponent) < game_board[index].value)
+	    exponent++;
+	if (exponent > 15)
+	    return false;
+	packed |= (uint64_t)exponent << (4 * index);
+    }
+    return true;
+}
+
+
 //Check if the game is over
 //  This function returns whether or not the game is over.
 //  We know the game is not over if either of the two
@@ -120,51 +187,56 @@ bool Game::is_game_won()
 //    empty spaces.
 bool Game::is_game_over()
 {
+    PROFILE_SCOPE("is_game_over");
     //If there are any empty space, game is not over.
     //If there are any 2048 spaces, the game is over.
-    for (int row = 0; row < grid_size; row++)
-	for (int column = 0; column < grid_size; column++)
-	{
-	    if (game_board[row][column].value == 0)
-		return false;
-	    else if (game_board[row][column].value >= 2048)
-		return true;
-        }
+    for (int index = 0; index < game_board.size(); index++)
+    {
+	if (game_board[index].value == 0)
+	    return false;
+	else if (game_board[index].value >= 2048)
+	    return true;
+    }
 
 
     //If any rows have adjacent pairs that match, game is not over
-    for (int row = 0; row < grid_size; row++)  //for each row...
+    for (int row = 0; row < rows; row++)  //for each row...
     {
+	const Tile* line = &game_board[row * columns];
+
 	//initialize previous value with the first element in the row
-        int previous = game_board[row][0].value;
+        int previous = line[0].value;
 
 	//Iterate through the rest of the row, comparing current value with
 	//  the previous value. Return true if we have a match. Update
 	//  previous if we do not.
-	for (int row_element = 1; row_element < grid_size; row_element++)
+	for (int row_element = 1; row_element < columns; row_element++)
 	{
-	    if(previous == game_board[row][row_element].value) //if previous == current
+	    if(previous == line[row_element].value) 	//if previous == current
 		return false;
-	    else					       //else update previous
-		previous = game_board[row][row_element].value;
+	    else					//else update previous
+		previous = line[row_element].value;
 	}
     }
 
-    //If any columns have adjacent pairs that match, game is not over
-    for (int column = 0; column < grid_size; column++)  //for each column...
+    //If any columns have adjacent pairs that match, game is not over.
+    //  Columns are rows of the transposed board.
+    for (int column = 0; column < columns; column++)  //for each column...
     {
-	//initialize previous value with the first element in the row
-        int previous = game_board[0][column].value;
+	const Tile* line = &transposed_board[column * rows];
 
-	//Iterate through the rest of the row, comparing current value with
+	//initialize previous value with the first element in the column
+        int previous = line[0].value;
+
+	//Iterate through the rest of the column, comparing current value with
 	//  the previous value. Return true if we have a match. Update
 	//  previous if we do not.
-	for (int column_element = 1; column_element < grid_size; column_element++)
+	for (int column_element = 1; column_element < rows; column_element++)
 	{
-	    if(previous == game_board[column_element][column].value) 	//if (previous == current) return false
+	    if(previous == line[column_element].value) 	//if (previous == current) return false
 		return false;
-	    else					       		//else update previous
-		previous = game_board[column_element][column].value;
+	    else					//else update previous
+		previous = line[column_element].value;
 	}
     }
 
@@ -178,7 +250,7 @@ bool Game::is_game_over()
 //  Call execute_move() with that random number.
 void Game::execute_random_move()
 {
-    int random = rand() % grid_size;
+    int random = rand() % 4;
     execute_move(random);
 }
 
@@ -193,181 +265,39 @@ void Game::execute_random_move()
 //    incremented
 void Game::execute_move(int move)
 {
+    PROFILE_SCOPE("execute_move");
     //we need to check and track if we are preforming a legal move.
     //  There are cases where the game is not over, but certain
     //  moves are not allowed. To prevent spawning new tiles and
-    //  incrementing the move counter in this scenario, we need to 
+    //  incrementing the move counter in this scenario, we need to
     //  check and track if a valid move was preformed.
     bool legal_move = false;
 
     //temporary vector to hold values from a single row or column
     std::vector<int> vector;
-    
-
-    //Move logic:
-    //  Lets say we are moving Left:
-    //  Now lets start with the first row:
-    //  Pull each value of the row out, and store into a vector.
-    //  The move will collapse the values, meaning that all tiles
-    //    that are empty will disapper (or be moved to the end, however
-    //    you want to think about it)
-    //  The move will also coalesce adjacent values if they are identical.
-    //  So...
-    //    1.) For each row, pull values out into a vector
-    //    2.) Remove all the zeros from that vector
-    //    3.) Traverse vector, coalescing same values into a single tile (of 2* value)
-    //    4.) Pad the end of the vector with zeros, so it is the correct size for a row
-    //    5.) Write out of the values of the vector back into the row
-    //
-    //  For a move to the right, we just invert the vector before and after we modify it.
-    //
-    //  For up and down moves, we use columns instead of rows (and do inversions on down)
-
-
-    //Move up or down
+    vector.reserve(std::max(rows, columns));
+
+    //Left and right moves work on the rows of the game board.
+    //  Up and down moves work on the rows of the transposed board
+    //  (the columns of the game board), so every line we touch is
+    //  contiguous in memory. Afterwards, the other copy is brought
+    //  back in sync with a blocked transpose.
     if (move == UP || move == DOWN)
     {
-	//Extract each column into a vector
-	for (int column = 0; column < grid_size; column++)
-	{
-	    for (int column_element = 0; column_element < grid_size; column_element++)
-	        vector.push_back(game_board[column_element][column].value);  //extract tile values
-	    
-	    //If moving down, invert the vector
-	    if (move == DOWN)
-	        invert_vector(vector);
-
-	    
-	    //Iterate through vector to Check if a valid move is being made
-	    int index = 0;
-	    bool found_empty_space = false;
-	    while (index < vector.size())
-	    {
-		//  Move is made if we find an empty space followed
-		//    by a non empty space.
-		if (!found_empty_space && vector[index] == 0)
-		    found_empty_space = !found_empty_space;
-
-		else if (found_empty_space && vector[index] != 0)
-		{
-		    legal_move = true;
-		    break;
-		}
-		index++;		    
-	    }
-	   
-	    //Remove the empty tiles from the vector
-	    remove_zero_entries(vector);
-	    
-	    //Perform the move for this column by coalescing adjacent identical
-	    //  values
-	    index = 0;	    
-	    while (index < vector.size() - 1)
-	    {
-		// The other case for a valid move would
-		//   be two adjacent tiles having the
-		//   same value (after removing all the
-		//   empty tiles).
-
-	        if (vector[index] == vector[index + 1])  	//if the next value matchs this value
-		{
-		    vector[index] *= 2;				//double this value
-		    vector.erase(vector.begin() + index + 1);   //remove the next value
-		    legal_move = true;
-		}
-		index++;
-	    }
-	   
-	    //After the move has been made, pad the vector with empty tiles
-	    //  to match the length of the column
-	    pad_with_zero(vector);
-
-	    //If moving down, re-invert the vector
-	    if (move == DOWN)
-	        invert_vector(vector);
-
-	    //write the values in the vector back into the column they originated from
-	    for (int element = 0; element < grid_size; element++)
-		    game_board[element][column].value = vector[element];
-	    
-	    //clean up before we start the next column
-	    vector.clear();
-	}
+	for (int column = 0; column < columns; column++)
+	    if (move_line(&transposed_board[column * rows], rows, move == DOWN, vector))
+		legal_move = true;
+	if (legal_move)
+	    sync_board(transposed_board, game_board, columns, rows);
     }
 
-
     else //move == right or left
     {
-	//Extract values of each row out into a vector (one row at a time)
-	for (int row = 0; row < grid_size; row++)
-	{
-	    for (int row_element = 0; row_element < grid_size; row_element++)
-	        vector.push_back(game_board[row][row_element].value);
-
-	    //If we are moving right, invert the vector before we begin
-	    if (move == RIGHT)
-	        invert_vector(vector);
-		 
-	   
-	    //Iterate through the vector and check if a valid move is being made 
-	    int index = 0;
-	    bool found_empty_space = false;
-	    while (index < vector.size())
-	    {
-		//  Move is made if we find an empty space followed
-		//    by a non empty space.
-		if (!found_empty_space && vector[index] == 0)
-		    found_empty_space = !found_empty_space;
-
-		else if (found_empty_space && vector[index] != 0)
-		{
-		    legal_move = true;
-		    break;
-		}
-
-		index++;		    
-	    }
-
-
-	    //Remove empty tiles from the vector
-	    remove_zero_entries(vector);
-	     
-	 	
-	   
-	    //Perform the move for this column by coalescing adjacent identical
-	    //  values
-	    index = 0;	    
-	    while (index < vector.size() - 1)
-	    {
-		// The other case for a valid move would
-		//   be two adjacent tiles having the
-		//   same value (after removing all the
-		//   empty tiles).
-	        if (vector[index] == vector[index + 1])		//If this value equals the next value
-		{
-		    vector[index] *= 2;				//Double this value
-		    vector.erase(vector.begin() + index + 1);	//delete next value
-		    legal_move = true;
-		}
-		index++;
-	    }
-	    
-	    //Pad the vector with empty tiles in order to make the vector the same
-	    //  size as a row
-	    pad_with_zero(vector);
-	    	    
-
-	    //If we are moving right, re-invert the vector
-	    if (move == RIGHT)
-		invert_vector(vector);
-
-	    //Write the values of the vector back out into the row the values originated from
-	    for (int element = 0; element < grid_size; element++)
-		    game_board[row][element].value = vector[element];
-	    
-	    //Clean up vector to prepare for use with the next row
-	    vector.clear();
-	}
+	for (int row = 0; row < rows; row++)
+	    if (move_line(&game_board[row * columns], columns, move == RIGHT, vector))
+		legal_move = true;
+	if (legal_move)
+	    sync_board(game_board, transposed_board, rows, columns);
     }
 
 
@@ -381,27 +311,144 @@ void Game::execute_move(int move)
 }
 
 
+//Move line
+//  Performs a move on a single contiguous row (of either copy of the
+//  board), towards its start, or towards its end if reverse is set.
+//  The vector is scratch space, passed in so it is only allocated once
+//  per move. Returns true if anything in the line moved.
+//
+//  Move logic:
+//  Lets say we are moving Left:
+//  Now lets start with the first row:
+//  Pull each value of the row out, and store into a vector.
+//  The move will collapse the values, meaning that all tiles
+//    that are empty will disapper (or be moved to the end, however
+//    you want to think about it)
+//  The move will also coalesce adjacent values if they are identical.
+//  So...
+//    1.) For each row, pull values out into a vector
+//    2.) Remove all the zeros from that vector
+//    3.) Traverse vector, coalescing same values into a single tile (of 2* value)
+//    4.) Pad the end of the vector with zeros, so it is the correct size for a row
+//    5.) Write out of the values of the vector back into the row
+//
+//  For a move to the right, we just invert the vector before and after we modify it.
+//
+//  For up and down moves, the caller passes us a row of the transposed board
+//    (and asks for inversions on down)
+bool Game::move_line(Tile* line, int length, bool reverse, std::vector<int> &vector)
+{
+    bool legal_move = false;
+
+    vector.clear();
+    for (int element = 0; element < length; element++)
+        vector.push_back(line[element].value);
+
+    //If we are moving right (or down), invert the vector before we begin
+    if (reverse)
+        invert_vector(vector);
+
+
+    //Iterate through the vector and check if a valid move is being made
+    int index = 0;
+    bool found_empty_space = false;
+    while (index < vector.size())
+    {
+	//  Move is made if we find an empty space followed
+	//    by a non empty space.
+	if (!found_empty_space && vector[index] == 0)
+	    found_empty_space = !found_empty_space;
+
+	else if (found_empty_space && vector[index] != 0)
+	{
+	    legal_move = true;
+	    break;
+	}
+
+	index++;
+    }
+
+
+    //Remove empty tiles from the vector
+    remove_zero_entries(vector);
+
+
+    //Perform the move for this line by coalescing adjacent identical
+    //  values
+    index = 0;
+    while (index < vector.size() - 1)
+    {
+	// The other case for a valid move would
+	//   be two adjacent tiles having the
+	//   same value (after removing all the
+	//   empty tiles).
+        if (vector[index] == vector[index + 1])		//If this value equals the next value
+	{
+	    vector[index] *= 2;				//Double this value
+	    vector.erase(vector.begin() + index + 1);	//delete next value
+	    legal_move = true;
+	}
+	index++;
+    }
+
+    //Pad the vector with empty tiles in order to make the vector the same
+    //  size as the line
+    pad_with_zero(vector, length);
+
+
+    //If we are moving right (or down), re-invert the vector
+    if (reverse)
+	invert_vector(vector);
+
+    //Write the values of the vector back out into the line the values originated from
+    for (int element = 0; element < length; element++)
+	line[element].value = vector[element];
+
+    return legal_move;
+}
+
+
+//Sync board
+//  Copies source (source_rows x source_columns, row-major) into
+//  destination as its transpose. This is done in small square blocks,
+//  so that the strided side of the copy stays in cache on wide boards.
+void Game::sync_board(const std::vector<Tile> &source, std::vector<Tile> &destination,
+		      int source_rows, int source_columns)
+{
+    for (int block_row = 0; block_row < source_rows; block_row += TRANSPOSE_BLOCK)
+	for (int block_column = 0; block_column < source_columns; block_column += TRANSPOSE_BLOCK)
+	{
+	    int last_row = std::min(block_row + TRANSPOSE_BLOCK, source_rows);
+	    int last_column = std::min(block_column + TRANSPOSE_BLOCK, source_columns);
+	    for (int row = block_row; row < last_row; row++)
+		for (int column = block_column; column < last_column; column++)
+		    destination[column * source_rows + row] = source[row * source_columns + column];
+	}
+}
+
+
 //Add new tile
 //  After every move, a random empty tile is chosen and its value is
 //  set at "2"
 void Game::add_new_tile() {
-        
+	PROFILE_SCOPE("add_new_tile");
+
 	//Locations of empty tiles are stored in a vector of <int,int> pairs
 	std::vector<std::pair<int,int> > blank_tiles;
 
 	//Iterate through each tile, storing the locations of any empty tiles we find
-        for (int row = 0; row < grid_size; row++)
-	    for (int column = 0; column < grid_size; column++)
-	        if (game_board[row][column].value == 0)			//If empty
+        for (int row = 0; row < rows; row++)
+	    for (int column = 0; column < columns; column++)
+	        if (tile_at(row, column).value == 0)			//If empty
 	   	    blank_tiles.push_back(std::make_pair(row, column)); //Save location
-        
+
 
 	//Pick a random entry from the vector. Update the blank tile at that loation by
 	//  setting its value at "2"
 	if (blank_tiles.size() > 0)
         {
             int random = rand() % blank_tiles.size();
-	    game_board[blank_tiles[random].first][blank_tiles[random].second].value = 2;
+	    set_tile_value(blank_tiles[random].first, blank_tiles[random].second, 2);
         }
 }
 
@@ -421,11 +468,11 @@ void Game::remove_zero_entries(std::vector<int> &vector)
 }
 
 
-//Pad a give vector (by reference) with zeros until it is the same size
-//  as this.grid_size
-void Game::pad_with_zero(std::vector<int> &vector)
+//Pad a give vector (by reference) with zeros until it is the given
+//  length (the length of a row or column)
+void Game::pad_with_zero(std::vector<int> &vector, int length)
 {
-    while (vector.size() < grid_size)
+    while (vector.size() < length)
 	vector.push_back(0);
 }
 
@@ -440,10 +487,11 @@ void Game::invert_vector(std::vector<int> &vector)
 //Print the game board to a given ncurses window (by reference)
 void Game::print_game_board(WINDOW* window)
 {
+    PROFILE_SCOPE("print_game_board");
     //For each tile, print the tile to the ncurses window
-    for (int row = 0; row < grid_size; row++)
-	for (int column = 0; column < grid_size; column++)
-	    print_tile(window, game_board[row][column], 2 + (row * 2), 3 + (column * 5));
+    for (int row = 0; row < rows; row++)
+	for (int column = 0; column < columns; column++)
+	    print_tile(window, tile_at(row, column), 2 + (row * 2), 3 + (column * 5));
 }
 
 
@@ -457,6 +505,6 @@ void Game::print_tile(WINDOW* window, Tile tile, int x_coord, int y_coord)
 	mvwprintw(window, x_coord, y_coord, "%2d  ", tile.value);
     else if (tile.value < 100)
 	mvwprintw(window, x_coord, y_coord, "%3d ", tile.value);
-    else 
+    else
 	mvwprintw(window, x_coord, y_coord, "%4d", tile.value);
 }
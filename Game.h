@@ -1,8 +1,10 @@
 #ifndef __Game_h__
 #define __Game_h__
 
+#include <assert.h>
 #include <time.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <algorithm>
 #include <vector>
 #include "ncurses.h"
@@ -19,8 +21,14 @@ class Game {
     public:
         Game();
 	Game(int grid_size);
-	~Game();
+	Game(int rows, int columns);
+	static bool is_valid_size(long rows, long columns);
+	static const long MAX_TILES = 1L << 22;	//largest board, rows * columns
 	int get_move_count() {return move_counter;}
+	int get_rows() {return rows;}
+	int get_columns() {return columns;}
+	int get_max_tile();
+	bool get_packed_board(uint64_t &packed);
 	void reset_game();
 	bool is_game_over();
 	bool is_game_won();
@@ -29,12 +37,24 @@ class Game {
 	void print_game_board(WINDOW* window);
 
     private:
-        Tile** game_board;
-	int grid_size;
+	//The board is stored twice: row-major in game_board and
+	//  column-major in transposed_board. Left/right moves walk
+	//  rows of game_board, up/down moves walk rows of
+	//  transposed_board, so both run over contiguous memory.
+	//  Every write goes to both (or is followed by a sync).
+	std::vector<Tile> game_board;
+	std::vector<Tile> transposed_board;
+	int rows;
+	int columns;
 	int move_counter;
 	void initialize();
+	Tile& tile_at(int row, int column) {return game_board[row * columns + column];}
+	void set_tile_value(int row, int column, int value);
+	bool move_line(Tile* line, int length, bool reverse, std::vector<int> &vector);
+	void sync_board(const std::vector<Tile> &source, std::vector<Tile> &destination,
+			int source_rows, int source_columns);
 	void remove_zero_entries(std::vector<int> &vector);
-	void pad_with_zero(std::vector<int> & vector);
+	void pad_with_zero(std::vector<int> & vector, int length);
 	void invert_vector(std::vector<int> & vector);
 	void add_new_tile();
 	void print_tile(WINDOW* window, Tile tile, int x_coord, int y_coord);
@@ -0,0 +1,201 @@
+/*
+ * Profile.cpp
+ *
+ * Author: Michael Denny
+ *
+ * Storage and export for the PROFILE_SCOPE timings (see Profile.h).
+ *
+ * Every thread that records a scope gets its own ring buffer, guarded
+ * by its own lock. Recording only takes the calling thread's lock,
+ * which nobody else touches except the exporter, so it stays
+ * uncontended, and profile_export() can run while other threads keep
+ * recording (they wait while their own buffer is being written out).
+ * When a ring buffer is full the oldest events are overwritten, but
+ * the per-phase totals (call count and total time) always cover the
+ * whole run.
+ *
+ */
+
+#include "Profile.h"
+
+#ifdef ENABLE_PROFILING
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <mutex>
+#include <vector>
+
+//Number of events kept per thread (about 1.5MB)
+static const long RING_CAPACITY = 1 << 16;
+
+//Upper bound on the number of distinct scope names
+static const int MAX_PHASES = 32;
+
+//Running totals for one scope name
+struct Phase_total {
+    const char* name;
+    long calls;
+    long total_ns;
+};
+
+//Everything recorded by one thread
+struct Profile_thread {
+    long tid;
+    std::vector<Profile_event> ring;
+    long recorded;		//total events ever recorded (ring index = recorded % capacity)
+    Phase_total phases[MAX_PHASES];
+    int phase_count;
+    std::mutex lock;		//held while recording into, or exporting, this thread
+};
+
+//Every thread that has recorded something, for the exporter
+static std::vector<Profile_thread*> threads;
+static std::mutex threads_lock;
+
+static thread_local Profile_thread* current_thread = NULL;
+
+
+//Set up the ring buffer for the calling thread
+static Profile_thread* register_thread()
+{
+    Profile_thread* thread = new Profile_thread;
+    thread->tid = syscall(SYS_gettid);
+    thread->ring.resize(RING_CAPACITY);
+    thread->recorded = 0;
+    thread->phase_count = 0;
+
+    std::lock_guard<std::mutex> guard(threads_lock);
+    threads.push_back(thread);
+    return thread;
+}
+
+
+//Store one finished scope in the calling thread's ring buffer
+void profile_record(const char* name, long start_ns, long duration_ns)
+{
+    if (current_thread == NULL)
+	current_thread = register_thread();
+    Profile_thread* thread = current_thread;
+    std::lock_guard<std::mutex> guard(thread->lock);
+
+    Profile_event &event = thread->ring[thread->recorded % RING_CAPACITY];
+    event.name = name;
+    event.start_ns = start_ns;
+    event.duration_ns = duration_ns;
+    thread->recorded++;
+
+    //Names are string literals, so comparing pointers is enough
+    for (int i = 0; i < thread->phase_count; i++)
+	if (thread->phases[i].name == name)
+	{
+	    thread->phases[i].calls++;
+	    thread->phases[i].total_ns += duration_ns;
+	    return;
+	}
+    if (thread->phase_count < MAX_PHASES)
+    {
+	Phase_total &phase = thread->phases[thread->phase_count++];
+	phase.name = name;
+	phase.calls = 1;
+	phase.total_ns = duration_ns;
+    }
+}
+
+
+//Write all ring buffers out as a Chrome trace ("X" complete events,
+//  timestamps in microseconds)
+static bool write_chrome_trace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+	return false;
+
+    long pid = getpid();
+    bool first = true;
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (int t = 0; t < threads.size(); t++)
+    {
+	Profile_thread* thread = threads[t];
+	std::lock_guard<std::mutex> thread_guard(thread->lock);
+	long kept = thread->recorded < RING_CAPACITY ? thread->recorded : RING_CAPACITY;
+	for (long i = thread->recorded - kept; i < thread->recorded; i++)
+	{
+	    const Profile_event &event = thread->ring[i % RING_CAPACITY];
+	    fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld}",
+		    first ? "" : ",\n", event.name, event.start_ns / 1000.0,
+		    event.duration_ns / 1000.0, pid, thread->tid);
+	    first = false;
+	}
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    return fclose(file) == 0;
+}
+
+
+//Print call counts and time spent per phase, summed over all threads
+static void print_phase_totals(FILE* out)
+{
+    Phase_total totals[MAX_PHASES];
+    int total_count = 0;
+    long dropped = 0;
+
+    for (int t = 0; t < threads.size(); t++)
+    {
+	Profile_thread* thread = threads[t];
+	std::lock_guard<std::mutex> thread_guard(thread->lock);
+	if (thread->recorded > RING_CAPACITY)
+	    dropped += thread->recorded - RING_CAPACITY;
+	for (int p = 0; p < thread->phase_count; p++)
+	{
+	    int i = 0;
+	    while (i < total_count && totals[i].name != thread->phases[p].name)
+		i++;
+	    if (i == total_count)
+	    {
+		if (total_count == MAX_PHASES)
+		    continue;
+		totals[total_count].name = thread->phases[p].name;
+		totals[total_count].calls = 0;
+		totals[total_count].total_ns = 0;
+		total_count++;
+	    }
+	    totals[i].calls += thread->phases[p].calls;
+	    totals[i].total_ns += thread->phases[p].total_ns;
+	}
+    }
+
+    fprintf(out, "[profile %ld] %-20s %12s %12s %10s\n", (long)getpid(), "phase", "calls", "total ms", "avg ns");
+    for (int i = 0; i < total_count; i++)
+	fprintf(out, "[profile %ld] %-20s %12ld %12.3f %10ld\n", (long)getpid(), totals[i].name,
+		totals[i].calls, totals[i].total_ns / 1e6, totals[i].total_ns / totals[i].calls);
+    if (dropped > 0)
+	fprintf(out, "[profile %ld] %ld oldest events were dropped from the trace\n", (long)getpid(), dropped);
+}
+
+
+void profile_export()
+{
+    const char* prefix = getenv("PROFILE_OUTPUT");
+    if (prefix == NULL)
+	return;
+
+    std::lock_guard<std::mutex> guard(threads_lock);
+    if (threads.empty())
+	return;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%ld.json", prefix, (long)getpid());
+    if (!write_chrome_trace(path))
+	perror(path);
+    print_phase_totals(stderr);
+}
+
+#else
+
+void profile_export()
+{
+}
+
+#endif
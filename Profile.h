@@ -0,0 +1,63 @@
+#ifndef __Profile_h__
+#define __Profile_h__
+
+#include <time.h>
+
+/*
+ * Optional timing instrumentation.
+ *
+ * PROFILE_SCOPE("name") times the rest of the enclosing block. It only
+ * does anything when built with -DENABLE_PROFILING (make PROFILE=1),
+ * otherwise it compiles away to nothing. The name must be a string
+ * literal: its address is used to tell phases apart.
+ */
+
+#ifdef ENABLE_PROFILING
+
+//One timed scope, as stored in a thread's ring buffer
+struct Profile_event {
+    const char* name;
+    long start_ns;
+    long duration_ns;
+};
+
+//Current CLOCK_MONOTONIC time in nanoseconds
+inline long profile_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+void profile_record(const char* name, long start_ns, long duration_ns);
+
+//Records the time between construction and destruction
+class Profile_scope {
+    public:
+	Profile_scope(const char* name) : name(name), start_ns(profile_now()) {}
+	~Profile_scope() {profile_record(name, start_ns, profile_now() - start_ns);}
+
+    private:
+	const char* name;
+	long start_ns;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) Profile_scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+#endif
+
+//Write everything recorded so far in this process, if the PROFILE_OUTPUT
+//  environment variable is set: a Chrome trace (chrome://tracing,
+//  Perfetto) to $PROFILE_OUTPUT.<pid>.json and per-phase totals to
+//  stderr. Safe to call while other threads are still recording.
+//  Does nothing in builds without ENABLE_PROFILING.
+void profile_export();
+
+
+#endif
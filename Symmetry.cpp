@@ -0,0 +1,181 @@
+/*
+ * Symmetry.cpp
+ *
+ * Author: Michael Denny
+ *
+ * Canonical form of packed boards (see Symmetry.h).
+ *
+ * The standard 4x4 board fills the whole uint64_t, one 16-bit row per
+ * tile row, so its mirror images can be built with a handful of shifts
+ * and masks. Other board shapes go through a plain tile-by-tile loop.
+ *
+ */
+
+#include "Symmetry.h"
+#include "Game.h"
+#include <algorithm>
+
+
+//Swap the board around its main diagonal (4x4 only)
+//  Tiles move in two steps: nibbles within each 2x2 block, then the
+//  2x2 blocks themselves.
+static inline uint64_t transpose_4x4(uint64_t board)
+{
+    uint64_t a1 = board & 0xF0F00F0FF0F00F0FULL;
+    uint64_t a2 = board & 0x0000F0F00000F0F0ULL;
+    uint64_t a3 = board & 0x0F0F00000F0F0000ULL;
+    uint64_t a = a1 | (a2 << 12) | (a3 >> 12);
+    uint64_t b1 = a & 0xFF00FF0000FF00FFULL;
+    uint64_t b2 = a & 0x00FF00FF00000000ULL;
+    uint64_t b3 = a & 0x00000000FF00FF00ULL;
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+
+//Reverse the order of the tiles in every row (4x4 only)
+static inline uint64_t flip_rows_4x4(uint64_t board)
+{
+    board = ((board & 0x0F0F0F0F0F0F0F0FULL) << 4) | ((board >> 4) & 0x0F0F0F0F0F0F0F0FULL);
+    return ((board & 0x00FF00FF00FF00FFULL) << 8) | ((board >> 8) & 0x00FF00FF00FF00FFULL);
+}
+
+
+//Reverse the order of the rows (4x4 only)
+static inline uint64_t flip_columns_4x4(uint64_t board)
+{
+    board = ((board & 0x0000FFFF0000FFFFULL) << 16) | ((board >> 16) & 0x0000FFFF0000FFFFULL);
+    return (board << 32) | (board >> 32);
+}
+
+
+//Smallest of the 8 symmetric versions of a 4x4 board
+//  Flipping after a transpose is the same as transposing after the
+//  other flip, which is how the second pass maps back onto the
+//  symmetry numbering in Symmetry.h.
+static uint64_t canonical_4x4(uint64_t board, int &symmetry)
+{
+    static const int pass_symmetries[2][4] = {{0, 1, 2, 3}, {4, 6, 5, 7}};
+    uint64_t best = board;
+    symmetry = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+	//Without and with a transpose: the 4 flips cover the other 6
+	uint64_t images[4];
+	images[0] = board;
+	images[1] = flip_rows_4x4(board);
+	images[2] = flip_columns_4x4(board);
+	images[3] = flip_columns_4x4(images[1]);
+	for (int i = 0; i < 4; i++)
+	    if (images[i] < best)
+	    {
+		best = images[i];
+		symmetry = pass_symmetries[pass][i];
+	    }
+	board = transpose_4x4(board);
+    }
+    return best;
+}
+
+
+//Packed boards hold at most 16 tiles
+bool packed_board_fits(int rows, int columns)
+{
+    return rows >= 1 && columns >= 1 && rows * columns <= 16;
+}
+
+
+//Apply symmetry
+//  Returns the image of a board under one symmetry, moving one tile at
+//  a time. Works for every board shape, but is slower than the 4x4
+//  shifts above.
+uint64_t apply_symmetry(uint64_t board, int rows, int columns, int symmetry)
+{
+    assert(packed_board_fits(rows, columns));
+    assert(symmetry >= 0 && symmetry < (rows == columns ? 8 : 4));
+
+    bool flip_row = symmetry & 1;
+    bool flip_column = symmetry & 2;
+    bool transpose = symmetry & 4;
+
+    uint64_t image = 0;
+    for (int index = 0; index < rows * columns; index++)
+    {
+	int row = index / columns;
+	int column = index % columns;
+	if (flip_row)
+	    column = columns - 1 - column;
+	if (flip_column)
+	    row = rows - 1 - row;
+	if (transpose)
+	    std::swap(row, column);
+	image |= ((board >> (4 * index)) & 0xF) << (4 * (row * columns + column));
+    }
+    return image;
+}
+
+
+//Canonical board
+//  Returns the smallest packed value among all symmetric versions of
+//  the board, so that mirror images all map to the same key. If
+//  symmetry is given, it is set to a symmetry that maps the board onto
+//  the returned one.
+uint64_t canonical_board(uint64_t board, int rows, int columns, int* symmetry)
+{
+    assert(packed_board_fits(rows, columns));
+
+    int best_symmetry = 0;
+    uint64_t best = board;
+    if (rows == 4 && columns == 4)
+	best = canonical_4x4(board, best_symmetry);
+    else
+    {
+	int symmetry_count = rows == columns ? 8 : 4;
+	for (int candidate = 1; candidate < symmetry_count; candidate++)
+	{
+	    uint64_t image = apply_symmetry(board, rows, columns, candidate);
+	    if (image < best)
+	    {
+		best = image;
+		best_symmetry = candidate;
+	    }
+	}
+    }
+
+    if (symmetry != NULL)
+	*symmetry = best_symmetry;
+    return best;
+}
+
+
+//Move to image
+//  Flips swap LEFT/RIGHT (bit 0) or UP/DOWN (bit 1), then a transpose
+//  swaps LEFT/UP and RIGHT/DOWN.
+int move_to_image(int move, int symmetry)
+{
+    if ((symmetry & 1) && (move == LEFT || move == RIGHT))
+	move = move == LEFT ? RIGHT : LEFT;
+    if ((symmetry & 2) && (move == UP || move == DOWN))
+	move = move == UP ? DOWN : UP;
+    if (symmetry & 4)
+    {
+	switch (move)
+	{
+	    case UP:    move = LEFT;  break;
+	    case DOWN:  move = RIGHT; break;
+	    case LEFT:  move = UP;    break;
+	    case RIGHT: move = DOWN;  break;
+	}
+    }
+    return move;
+}
+
+
+//Move from image
+//  Undoes move_to_image(): the same steps in reverse order. Each step
+//  is its own inverse.
+int move_from_image(int move, int symmetry)
+{
+    if (symmetry & 4)
+	move = move_to_image(move, 4);
+    return move_to_image(move, symmetry & 3);
+}
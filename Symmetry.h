@@ -0,0 +1,89 @@
+#ifndef __Symmetry_h__
+#define __Symmetry_h__
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unordered_map>
+
+/*
+ * Packed boards and symmetry canonicalization.
+ *
+ * A packed board holds up to 16 tiles in a uint64_t, 4 bits per tile,
+ * row-major: tile (row, column) is nibble (row * columns + column). A
+ * nibble holds log2 of the tile value, 0 for an empty tile. Boards of
+ * more than 16 tiles can not be packed (see packed_board_fits()).
+ *
+ * Moves treat the board the same under its symmetries (a mirror image
+ * of a position plays out as the mirror image of its game), so any
+ * table of positions only needs to store one of them. canonical_board()
+ * picks the smallest packed value of all the symmetric versions of a
+ * board: 8 for square boards, 4 (flips and half turn) for rectangular
+ * ones.
+ *
+ * A symmetry is a number from 0 to 7: bit 0 reverses the tiles within
+ * each row, bit 1 reverses the order of the rows, and bit 2 (square
+ * boards only) then transposes the board. Symmetry 0 is the identity.
+ */
+
+bool packed_board_fits(int rows, int columns);
+uint64_t apply_symmetry(uint64_t board, int rows, int columns, int symmetry);
+uint64_t canonical_board(uint64_t board, int rows, int columns, int* symmetry = NULL);
+
+//Translate a move (see the Moves enum) between a board and its image
+//  under a symmetry: making move M on a board and then applying the
+//  symmetry gives the same result as applying the symmetry first and
+//  then making move_to_image(M). move_from_image() goes the other way,
+//  e.g. to turn a best move stored for a canonical board back into a
+//  move on the board that was looked up.
+int move_to_image(int move, int symmetry);
+int move_from_image(int move, int symmetry);
+
+//Lookup table of positions, keyed by their canonical board, so that
+//  all symmetric versions of a position share a single entry.
+//  A lookup may return the value stored for a mirror image of the
+//  board, so Value must not depend on orientation (a score, a count,
+//  a win/loss). To store something that does, such as a best move,
+//  store it for the canonical board (canonical_board() gives the
+//  symmetry) and map it back with move_from_image() after lookup.
+template <class Value>
+class Canonical_cache {
+
+    public:
+	Canonical_cache(int rows, int columns) : rows(rows), columns(columns)
+	{
+	    assert(packed_board_fits(rows, columns));
+	}
+	size_t size() {return table.size();}
+	void clear() {table.clear();}
+
+	//Returns true and sets value if the board (or a mirror image) is stored
+	bool lookup(uint64_t board, Value &value)
+	{
+	    typename std::unordered_map<uint64_t, Value>::iterator entry =
+		table.find(canonical_board(board, rows, columns));
+	    if (entry == table.end())
+		return false;
+	    value = entry->second;
+	    return true;
+	}
+
+	void store(uint64_t board, const Value &value)
+	{
+	    table[canonical_board(board, rows, columns)] = value;
+	}
+
+	//Entry for the board (or a mirror image), created if missing
+	Value& operator[](uint64_t board)
+	{
+	    return table[canonical_board(board, rows, columns)];
+	}
+
+    private:
+	std::unordered_map<uint64_t, Value> table;
+	int rows;
+	int columns;
+};
+
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Symmetry_check.cpp
+ *
+ * Author: Michael Denny
+ *
+ * Self check for Symmetry.cpp, run by "make check".
+ *
+ * The 4x4 shift-and-mask code is checked against the plain tile loop
+ * in apply_symmetry(), and the move mapping against single tile boards
+ * slid by hand. Prints the first failure and exits with 1, or exits
+ * with 0 if everything matches.
+ *
+ */
+
+#include "Symmetry.h"
+#include "Game.h"
+#include <stdio.h>
+
+
+//Random packed board of the given shape
+static uint64_t random_board(int rows, int columns)
+{
+    uint64_t board = 0;
+    for (int index = 0; index < rows * columns; index++)
+	board |= (uint64_t)(rand() % 16) << (4 * index);
+    return board;
+}
+
+
+//Canonical board and symmetry, the slow way: every image through
+//  apply_symmetry(), keep the smallest
+static uint64_t reference_canonical(uint64_t board, int rows, int columns)
+{
+    int symmetry_count = rows == columns ? 8 : 4;
+    uint64_t best = board;
+    for (int symmetry = 1; symmetry < symmetry_count; symmetry++)
+	best = std::min(best, apply_symmetry(board, rows, columns, symmetry));
+    return best;
+}
+
+
+//Slide the only tile of a board as far as it goes in a direction
+static uint64_t slide_single_tile(uint64_t board, int rows, int columns, int move)
+{
+    for (int index = 0; index < rows * columns; index++)
+    {
+	uint64_t tile = (board >> (4 * index)) & 0xF;
+	if (tile == 0)
+	    continue;
+	int row = index / columns;
+	int column = index % columns;
+	if (move == UP)
+	    row = 0;
+	else if (move == DOWN)
+	    row = rows - 1;
+	else if (move == LEFT)
+	    column = 0;
+	else if (move == RIGHT)
+	    column = columns - 1;
+	return tile << (4 * (row * columns + column));
+    }
+    return board;
+}
+
+
+//Check canonical_board() on random boards of one shape
+static bool check_shape(int rows, int columns, int boards)
+{
+    int symmetry_count = rows == columns ? 8 : 4;
+    for (int i = 0; i < boards; i++)
+    {
+	uint64_t board = random_board(rows, columns);
+	int symmetry;
+	uint64_t canonical = canonical_board(board, rows, columns, &symmetry);
+
+	if (canonical != reference_canonical(board, rows, columns))
+	{
+	    printf("FAIL %dx%d: canonical_board(%016llx) = %016llx, reference disagrees\n",
+		   rows, columns, (unsigned long long)board, (unsigned long long)canonical);
+	    return false;
+	}
+	if (apply_symmetry(board, rows, columns, symmetry) != canonical)
+	{
+	    printf("FAIL %dx%d: symmetry %d does not map %016llx onto its canonical board\n",
+		   rows, columns, symmetry, (unsigned long long)board);
+	    return false;
+	}
+
+	//Every image must share the same key
+	for (int image = 0; image < symmetry_count; image++)
+	    if (canonical_board(apply_symmetry(board, rows, columns, image), rows, columns) != canonical)
+	    {
+		printf("FAIL %dx%d: image %d of %016llx has a different key\n",
+		       rows, columns, image, (unsigned long long)board);
+		return false;
+	    }
+    }
+    return true;
+}
+
+
+//Check move_to_image() and move_from_image() for one shape
+static bool check_moves(int rows, int columns)
+{
+    int symmetry_count = rows == columns ? 8 : 4;
+    for (int index = 0; index < rows * columns; index++)
+    {
+	uint64_t board = (uint64_t)1 << (4 * index);
+	for (int symmetry = 0; symmetry < symmetry_count; symmetry++)
+	    for (int move = UP; move <= RIGHT; move++)
+	    {
+		uint64_t moved_then_mapped = apply_symmetry(slide_single_tile(board, rows, columns, move),
+							    rows, columns, symmetry);
+		uint64_t mapped_then_moved = slide_single_tile(apply_symmetry(board, rows, columns, symmetry),
+							       rows, columns, move_to_image(move, symmetry));
+		if (moved_then_mapped != mapped_then_moved
+		    || move_from_image(move_to_image(move, symmetry), symmetry) != move)
+		{
+		    printf("FAIL %dx%d: move %d under symmetry %d\n", rows, columns, move, symmetry);
+		    return false;
+		}
+	    }
+    }
+    return true;
+}
+
+
+int main()
+{
+    srand(2048);
+
+    int shapes[][2] = {{4, 4}, {3, 3}, {2, 2}, {3, 5}, {2, 8}, {8, 2}, {1, 16}};
+    for (int i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++)
+	if (!check_shape(shapes[i][0], shapes[i][1], 100000) || !check_moves(shapes[i][0], shapes[i][1]))
+	    return 1;
+
+    if (packed_board_fits(5, 5) || packed_board_fits(6, 6) || !packed_board_fits(4, 4))
+    {
+	printf("FAIL packed_board_fits\n");
+	return 1;
+    }
+
+    printf("Symmetry checks passed\n");
+    return 0;
+}
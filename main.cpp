@@ -7,15 +7,24 @@
  * The display is implemented using ncurses. The game consists of a
  * "Game" object.
  * 
- * You can change the size of the grid by modifying the "grid_size"
- * variable. I might incorporate this into an interaction user selection
- * in the future. But probably not, because this program has already
- * answered the questions I had about the 2048 game.
+ * You can change the size of the grid by modifying the "grid_rows"
+ * and "grid_columns" variables (the grid does not need to be square).
+ * I might incorporate this into an interaction user selection in the
+ * future. But probably not, because this program has already answered
+ * the questions I had about the 2048 game.
  *
  * Also, there is code to allow for user input to play the game. It
  * is currently commented out. Just uncomment that code, and commit the
  * random input code and you'll have a functional 2048 CLI clone.
  *
+ * Batch mode (no ncurses) plays random games spread across a number
+ * of local worker processes and prints a summary:
+ *
+ *   ./2048 --batch <games> [--workers N] [--grid N] [--rows N] [--cols N]
+ *                          [--seed N] [--job-size N] [--retries N]
+ *                          [--timeout SECONDS] [--end-states]
+ *   ./2048 --worker        (protocol on stdin/stdout, see Batch.cpp)
+ *
  * Feel free to do whatever you want with this. It was just a weekend
  * curiosity. I will probably never touch it again.
  *
@@ -25,16 +34,179 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <limits.h>
 #include "Game.h"
+#include "Batch.h"
+#include "Profile.h"
+#include "Symmetry.h"
+
+
+//Parse a whole command line argument as a number in [minimum, maximum].
+//  Prints an error and returns false if it is not one.
+bool parse_number(const char* option, const char* text, long minimum, long maximum, long &value)
+{
+    char* end;
+    errno = 0;
+    value = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || value < minimum || value > maximum)
+    {
+	printf("Invalid value for %s: %s (need a number from %ld to %ld)\n", option, text, minimum, maximum);
+	return false;
+    }
+    return true;
+}
+
+
+//Run the coordinator with the settings given on the command line
+//  and print out a summary of the results.
+int run_batch_mode(int argc, char** argv)
+{
+    Batch_options options;
+    options.worker_count = 1;
+    options.rows = 4;
+    options.columns = 4;
+    options.seed_start = time(NULL);
+    options.job_size = 1000;
+    options.max_retries = 3;
+    options.stall_timeout = 60;
+    options.end_states = false;
+
+    if (argc < 3)
+    {
+	printf("Missing value for --batch\n");
+	return 1;
+    }
+    //srand() takes an unsigned int, so every seed must fit in one
+    if (!parse_number("--batch", argv[2], 1, (long)UINT_MAX + 1, options.total_games))
+	return 1;
+
+    for (int i = 3; i < argc; i += 2)
+    {
+	const char* option = argv[i];
+
+	//Options without a value
+	if (strcmp(option, "--end-states") == 0)
+	{
+	    options.end_states = true;
+	    i--;
+	    continue;
+	}
+
+	//Smallest value each option accepts
+	long minimum;
+	if (strcmp(option, "--seed") == 0 || strcmp(option, "--retries") == 0)
+	    minimum = 0;
+	else if (strcmp(option, "--workers") == 0 || strcmp(option, "--rows") == 0
+		 || strcmp(option, "--cols") == 0 || strcmp(option, "--job-size") == 0
+		 || strcmp(option, "--timeout") == 0)
+	    minimum = 1;
+	else if (strcmp(option, "--grid") == 0)
+	    minimum = 2;
+	else
+	{
+	    printf("Unknown option: %s\n", option);
+	    return 1;
+	}
+
+	if (i + 1 >= argc)
+	{
+	    printf("Missing value for %s\n", option);
+	    return 1;
+	}
+
+	long value;
+	if (!parse_number(option, argv[i + 1], minimum, strcmp(option, "--seed") == 0 ? (long)UINT_MAX : INT_MAX, value))
+	    return 1;
+
+	if (strcmp(option, "--workers") == 0)
+	    options.worker_count = value;
+	else if (strcmp(option, "--grid") == 0)
+	    options.rows = options.columns = value;
+	else if (strcmp(option, "--rows") == 0)
+	    options.rows = value;
+	else if (strcmp(option, "--cols") == 0)
+	    options.columns = value;
+	else if (strcmp(option, "--seed") == 0)
+	    options.seed_start = value;
+	else if (strcmp(option, "--job-size") == 0)
+	    options.job_size = value;
+	else if (strcmp(option, "--retries") == 0)
+	    options.max_retries = value;
+	else if (strcmp(option, "--timeout") == 0)
+	    options.stall_timeout = value;
+    }
+
+    if (options.seed_start > (long)UINT_MAX - (options.total_games - 1))
+    {
+	printf("Seeds %ld - %ld go past %u, the largest seed srand() takes\n",
+	       options.seed_start, options.seed_start + options.total_games - 1, UINT_MAX);
+	return 1;
+    }
+    if (!Game::is_valid_size(options.rows, options.columns))
+    {
+	printf("Board must have from 2 to %ld tiles, got %dx%d\n", Game::MAX_TILES, options.rows, options.columns);
+	return 1;
+    }
+    if (options.end_states && !packed_board_fits(options.rows, options.columns))
+    {
+	printf("--end-states needs a board of at most 16 tiles, got %dx%d\n", options.rows, options.columns);
+	return 1;
+    }
+
+    struct timespec start, finish;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Batch_summary summary;
+    if (run_coordinator(options, summary) != 0)
+	return 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("Grid size:       %dx%d\n", options.rows, options.columns);
+    printf("Workers:         %d\n", summary.workers);
+    printf("Seeds:           %ld - %ld\n", options.seed_start, options.seed_start + options.total_games - 1);
+    printf("Games played:    %ld\n", summary.games);
+    printf("Games won:       %ld\n", summary.wins);
+    printf("Average moves:   %.1f\n", summary.games ? (double)summary.total_moves / summary.games : 0.0);
+    printf("Largest tile:    %d\n", summary.max_tile);
+    printf("Worker restarts: %ld\n", summary.worker_restarts);
+    printf("Failed jobs:     %ld\n", summary.failed_jobs);
+    if (options.end_states)
+    {
+	printf("End states:      %ld distinct (up to symmetry)\n", summary.end_states);
+	printf("Most common:     %ld games ended on\n", summary.common_end_state_count);
+	for (int row = 0; row < options.rows; row++)
+	{
+	    printf("    ");
+	    for (int column = 0; column < options.columns; column++)
+	    {
+		int exponent = (summary.common_end_state >> (4 * (row * options.columns + column))) & 0xF;
+		printf("%5d", exponent ? 1 << exponent : 0);
+	    }
+	    printf("\n");
+	}
+    }
+    printf("Elapsed:         %.3f s (%.0f games/sec)\n", seconds, seconds > 0 ? summary.games / seconds : 0.0);
+    return summary.failed_jobs == 0 ? 0 : 1;
+}
 
 
 int main(int argc, char** argv)
 {
+    //Headless modes, no ncurses
+    if (argc >= 2 && strcmp(argv[1], "--batch") == 0)
+	return run_batch_mode(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "--worker") == 0)
+	return run_worker(0, 1);
+
     srand(time(NULL));  //Seed rand()
 
-    int grid_size = 4;  //Size of the playing grid
+    int grid_rows = 4;  	//Size of the playing grid: rows
+    int grid_columns = 4;	//Size of the playing grid: columns
 
-    Game* my_game = new Game(grid_size);  //Game object
+    Game* my_game = new Game(grid_rows, grid_columns);  //Game object
     
     //Some variables
     int terminal_height,        //Size of Terminal window: rows
@@ -62,13 +234,13 @@ int main(int argc, char** argv)
     * Cacluate game area dimensions:
     *   The height and width are primarily defined by the grid
     *     size. I want an empty space before and after each row/column.
-    *     This is why we start with (grid_size + 1). 
+    *     This is why we start with (grid_rows + 1) and (grid_columns + 1).
     *   Game is double spaced, so base height is multiplied by 2.
     *   Each game "tile" can consist of up to 4 digits. Including
     *     the space between tiles, so the width is multiplied by 5.
     */
-    my_game_area_height = (grid_size + 1) * 2 + 1;
-    my_game_area_width = (grid_size + 1 ) * 5;
+    my_game_area_height = (my_game->get_rows() + 1) * 2 + 1;
+    my_game_area_width = (my_game->get_columns() + 1 ) * 5;
 
 
     //Initialize the ncurses "window"   
@@ -97,7 +269,7 @@ int main(int argc, char** argv)
     {
 	endwin();
 	printf("Terminal window is too small.\n");
-	printf("Grid size is %d.\n", grid_size);
+	printf("Grid size is %dx%d.\n", my_game->get_rows(), my_game->get_columns());
 	printf("Need %d rows, have %d rows.\n", min_req_height, terminal_height);
 	printf("Need %d cols, have %d cols.\n", min_req_width, terminal_width);
 	printf("Exiting...\n");
@@ -216,5 +388,6 @@ int main(int argc, char** argv)
 
     //Destroy ncurses, restoring terminal
     endwin();
+    profile_export();
     return 0;
 }